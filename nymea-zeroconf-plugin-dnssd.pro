@@ -1,29 +1,6 @@
-TEMPLATE = lib
-TARGET = $$qtLibraryTarget(nymea_zeroconfplugindnssd)
+TEMPLATE = subdirs
 
-QT -= gui
-QT += network dbus
+SUBDIRS += plugin journaltool
 
-QMAKE_CXXFLAGS += -Werror
-
-CONFIG += plugin link_pkgconfig c++11
-PKGCONFIG += nymea
-
-avahi-compat {
-DEFINES += AVAHI_COMPAT
-}
-
-LIBS += -ldns_sd
-
-SOURCES += platformzeroconfcontrollerdnssd.cpp \
-    zeroconfservicebrowserdnssd.cpp \
-    zeroconfservicepublisherdnssd.cpp
-
-
-HEADERS += platformzeroconfcontrollerdnssd.h \
-    zeroconfservicebrowserdnssd.h \
-    zeroconfservicepublisherdnssd.h
-
-
-target.path = $$[QT_INSTALL_LIBS]/nymea/platform/
-INSTALLS += target
+plugin.file = plugin.pro
+journaltool.subdir = tools/nymea-zeroconf-journal
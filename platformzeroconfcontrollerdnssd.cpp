@@ -31,16 +31,69 @@
 #include "platformzeroconfcontrollerdnssd.h"
 #include "zeroconfservicebrowserdnssd.h"
 #include "zeroconfservicepublisherdnssd.h"
+#include "zeroconfdiscoveryjournal.h"
 
+#include <loggingcategories.h>
+#include <nymeasettings.h>
+
+#include <sys/socket.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+
+// Unix signal handlers may not call Qt functions. The handler only writes to a socket pair,
+// the actual dump happens in the event loop when the other end becomes readable.
+static int s_journalSignalFds[2] = { -1, -1 };
+static struct sigaction s_previousSigUsr1Action;
+
+static void journalSignalHandler(int)
+{
+    char c = 1;
+    ssize_t written = write(s_journalSignalFds[0], &c, sizeof(c));
+    Q_UNUSED(written)
+}
 
 PlatformZeroConfPluginControllerDnssd::PlatformZeroConfPluginControllerDnssd(QObject *parent):
     PlatformZeroConfController(parent)
 {
     m_servicePublisher = new ZeroConfServicePublisherDnssd(this);
+
+    // The discovery journal can be dumped at any time by sending SIGUSR1 to nymead.
+    QString journalFile = QString::fromLocal8Bit(qgetenv("NYMEA_ZEROCONF_JOURNAL"));
+    m_journalFile = journalFile.isEmpty() ? NymeaSettings::storagePath() + "/zeroconf-journal.bin" : journalFile;
+    if (!setupJournalSignal()) {
+        qCWarning(dcPlatformZeroConf()) << "Unable to install SIGUSR1 handler for dumping the ZeroConf discovery journal.";
+    }
+
+    // Optionally keep it on disk all the time, so it survives crashes and restarts.
+    // Flushing rewrites the whole journal, so don't do it too often on flash storage.
+    if (!journalFile.isEmpty()) {
+        bool ok = false;
+        int interval = qgetenv("NYMEA_ZEROCONF_JOURNAL_INTERVAL").toInt(&ok);
+        if (!ok || interval <= 0) {
+            interval = 300;
+        }
+        qCDebug(dcPlatformZeroConf()) << "Writing ZeroConf discovery journal to" << m_journalFile << "every" << interval << "seconds";
+        m_journalFlushTimer.setInterval(interval * 1000);
+        connect(&m_journalFlushTimer, &QTimer::timeout, this, &PlatformZeroConfPluginControllerDnssd::flushJournal);
+        m_journalFlushTimer.start();
+    }
 }
 
 PlatformZeroConfPluginControllerDnssd::~PlatformZeroConfPluginControllerDnssd()
 {
+    if (m_journalFlushTimer.isActive()) {
+        flushJournal();
+    }
+
+    if (m_journalSignalNotifier) {
+        sigaction(SIGUSR1, &s_previousSigUsr1Action, nullptr);
+        delete m_journalSignalNotifier;
+        close(s_journalSignalFds[0]);
+        close(s_journalSignalFds[1]);
+        s_journalSignalFds[0] = -1;
+        s_journalSignalFds[1] = -1;
+    }
 }
 
 ZeroConfServiceBrowser *PlatformZeroConfPluginControllerDnssd::createServiceBrowser(const QString &serviceType)
@@ -52,3 +105,57 @@ ZeroConfServicePublisher *PlatformZeroConfPluginControllerDnssd::servicePublishe
 {
     return  m_servicePublisher;
 }
+
+void PlatformZeroConfPluginControllerDnssd::flushJournal()
+{
+    if (ZeroConfDiscoveryJournal::instance()->recordCount() == m_flushedRecords) {
+        return;
+    }
+    writeJournal();
+}
+
+void PlatformZeroConfPluginControllerDnssd::dumpJournal()
+{
+    char c;
+    while (read(s_journalSignalFds[1], &c, sizeof(c)) > 0) { }
+
+    if (writeJournal()) {
+        qCInfo(dcPlatformZeroConf()) << "ZeroConf discovery journal written to" << m_journalFile;
+    }
+}
+
+bool PlatformZeroConfPluginControllerDnssd::setupJournalSignal()
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, s_journalSignalFds) == -1) {
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = journalSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &action, &s_previousSigUsr1Action) == -1) {
+        close(s_journalSignalFds[0]);
+        close(s_journalSignalFds[1]);
+        s_journalSignalFds[0] = -1;
+        s_journalSignalFds[1] = -1;
+        return false;
+    }
+
+    m_journalSignalNotifier = new QSocketNotifier(s_journalSignalFds[1], QSocketNotifier::Read, this);
+    connect(m_journalSignalNotifier, &QSocketNotifier::activated, this, &PlatformZeroConfPluginControllerDnssd::dumpJournal);
+    return true;
+}
+
+bool PlatformZeroConfPluginControllerDnssd::writeJournal()
+{
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    quint64 recordCount = journal->recordCount();
+    if (!journal->dump(m_journalFile)) {
+        qCWarning(dcPlatformZeroConf()) << "Failed to write ZeroConf discovery journal to" << m_journalFile;
+        return false;
+    }
+    m_flushedRecords = recordCount;
+    return true;
+}
@@ -32,6 +32,8 @@
 #define PLATFORMZEROCONFCONTROLLERNSDK_H
 
 #include <QObject>
+#include <QTimer>
+#include <QSocketNotifier>
 
 #include <platform/platformzeroconfcontroller.h>
 
@@ -50,9 +52,21 @@ public:
     ZeroConfServiceBrowser *createServiceBrowser(const QString &serviceType) override;
     ZeroConfServicePublisher *servicePublisher() const override;
 
+private slots:
+    void flushJournal();
+    void dumpJournal();
+
 private:
     ZeroConfServiceBrowserDnssd *m_serviceBrowser = nullptr;
     ZeroConfServicePublisherDnssd *m_servicePublisher = nullptr;
+
+    bool setupJournalSignal();
+    bool writeJournal();
+
+    QString m_journalFile;
+    QTimer m_journalFlushTimer;
+    quint64 m_flushedRecords = 0;
+    QSocketNotifier *m_journalSignalNotifier = nullptr;
 };
 
 #endif // PLATFORMZEROCONFCONTROLLERNSDK_H
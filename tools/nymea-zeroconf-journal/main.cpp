@@ -0,0 +1,97 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zeroconfdiscoveryjournal.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QMap>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("nymea-zeroconf-journal");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a ZeroConf discovery journal as per-service timelines.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "The journal file written by the dnssd ZeroConf plugin.");
+    QCommandLineOption filterOption({"s", "service"}, "Only show services containing <text>.", "text");
+    parser.addOption(filterOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1) {
+        parser.showHelp(1);
+    }
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList ids;
+    QList<ZeroConfDiscoveryJournal::Record> records;
+    if (!ZeroConfDiscoveryJournal::load(parser.positionalArguments().first(), &ids, &records)) {
+        err << "Failed to read journal " << parser.positionalArguments().first() << "\n";
+        return 1;
+    }
+
+    // Records are stored in the order they were written, so grouping keeps each timeline sorted
+    QMap<QString, QList<ZeroConfDiscoveryJournal::Record> > timelines;
+    foreach (const ZeroConfDiscoveryJournal::Record &record, records) {
+        QString id = record.id < static_cast<quint32>(ids.count()) ? ids.at(static_cast<int>(record.id)) : QString("<invalid id %1>").arg(record.id);
+        if (parser.isSet(filterOption) && !id.contains(parser.value(filterOption))) {
+            continue;
+        }
+        timelines[id].append(record);
+    }
+
+    foreach (const QString &id, timelines.keys()) {
+        out << id << "\n";
+        foreach (const ZeroConfDiscoveryJournal::Record &record, timelines.value(id)) {
+            out << "  " << QDateTime::fromMSecsSinceEpoch(record.timestamp).toString("yyyy-MM-dd hh:mm:ss.zzz")
+                << "  if " << record.interfaceIndex
+                << "  " << ZeroConfDiscoveryJournal::eventKindToString(record.kind);
+            if (record.kind == ZeroConfDiscoveryJournal::EventKindHostLookupFailed) {
+                out << "  QHostInfo error " << record.errorCode;
+            } else if (record.errorCode != 0) {
+                out << "  dns_sd error " << record.errorCode;
+            }
+            if (record.flags != 0) {
+                out << "  flags 0x" << QString::number(record.flags, 16);
+            }
+            out << "\n";
+        }
+    }
+
+    out.flush();
+    return 0;
+}
@@ -0,0 +1,18 @@
+TEMPLATE = app
+TARGET = nymea-zeroconf-journal
+
+QT -= gui
+
+CONFIG += console c++11
+
+QMAKE_CXXFLAGS += -Werror
+
+INCLUDEPATH += ../../
+
+SOURCES += main.cpp \
+    ../../zeroconfdiscoveryjournal.cpp
+
+HEADERS += ../../zeroconfdiscoveryjournal.h
+
+target.path = $$[QT_INSTALL_PREFIX]/bin
+INSTALLS += target
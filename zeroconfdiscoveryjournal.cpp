@@ -0,0 +1,191 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zeroconfdiscoveryjournal.h"
+
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFile>
+
+static const quint32 journalMagic = 0x4e5a4a31; // "NZJ1"
+static const quint32 journalVersion = 1;
+static const int maxInternedIds = 65536;
+
+ZeroConfDiscoveryJournal::ZeroConfDiscoveryJournal()
+{
+    // Id 0 is used for events which can't be attributed, e.g. when the id table is full.
+    m_ids.append("<unknown>");
+}
+
+ZeroConfDiscoveryJournal *ZeroConfDiscoveryJournal::instance()
+{
+    static ZeroConfDiscoveryJournal journal;
+    return &journal;
+}
+
+quint32 ZeroConfDiscoveryJournal::intern(const QString &id)
+{
+    QHash<QString, quint32>::const_iterator it = m_idIndex.constFind(id);
+    if (it != m_idIndex.constEnd()) {
+        return it.value();
+    }
+    if (m_ids.count() >= maxInternedIds) {
+        return 0;
+    }
+    quint32 index = static_cast<quint32>(m_ids.count());
+    m_ids.append(id);
+    m_idIndex.insert(id, index);
+    return index;
+}
+
+void ZeroConfDiscoveryJournal::record(EventKind kind, quint32 id, quint32 interfaceIndex, qint32 errorCode, quint32 flags)
+{
+    // Each slot carries the sequence number of the record it holds, 0 while being written,
+    // so a concurrent dump can detect and skip slots which are overwritten under its feet.
+    quint64 sequence = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[sequence % capacity];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    slot.record.kind = kind;
+    slot.record.id = id;
+    slot.record.interfaceIndex = interfaceIndex;
+    slot.record.errorCode = errorCode;
+    slot.record.flags = flags;
+
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+quint64 ZeroConfDiscoveryJournal::recordCount() const
+{
+    return m_head.load(std::memory_order_relaxed);
+}
+
+bool ZeroConfDiscoveryJournal::dump(const QString &fileName) const
+{
+    QList<Record> records;
+    quint64 head = m_head.load(std::memory_order_acquire);
+    quint64 start = head > capacity ? head - capacity : 0;
+    for (quint64 sequence = start; sequence < head; sequence++) {
+        const Slot &slot = m_slots[sequence % capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != sequence + 1) {
+            continue;
+        }
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence + 1) {
+            continue;
+        }
+        records.append(record);
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << journalMagic << journalVersion << m_ids << static_cast<quint32>(records.count());
+    foreach (const Record &record, records) {
+        stream << record.timestamp << record.kind << record.id << record.interfaceIndex << record.errorCode << record.flags;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool ZeroConfDiscoveryJournal::load(const QString &fileName, QStringList *ids, QList<Record> *records)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version;
+    if (magic != journalMagic || version != journalVersion) {
+        return false;
+    }
+    stream >> *ids >> count;
+    if (count > capacity) {
+        return false;
+    }
+    for (quint32 i = 0; i < count; i++) {
+        Record record;
+        stream >> record.timestamp >> record.kind >> record.id >> record.interfaceIndex >> record.errorCode >> record.flags;
+        records->append(record);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+QString ZeroConfDiscoveryJournal::eventKindToString(quint32 kind)
+{
+    switch (kind) {
+    case EventKindBrowseAdded:
+        return "BrowseAdded";
+    case EventKindBrowseRemoved:
+        return "BrowseRemoved";
+    case EventKindBrowseFailed:
+        return "BrowseFailed";
+    case EventKindResolveFailed:
+        return "ResolveFailed";
+    case EventKindResolved:
+        return "Resolved";
+    case EventKindAddressFailed:
+        return "AddressFailed";
+    case EventKindAddressResolved:
+        return "AddressResolved";
+    case EventKindEntryAdded:
+        return "EntryAdded";
+    case EventKindEntryDuplicate:
+        return "EntryDuplicate";
+    case EventKindRegistered:
+        return "Registered";
+    case EventKindRegisterFailed:
+        return "RegisterFailed";
+    case EventKindUnregistered:
+        return "Unregistered";
+    case EventKindReannounced:
+        return "Reannounced";
+    case EventKindHostLookupFailed:
+        return "HostLookupFailed";
+    }
+    return QString("Unknown(%1)").arg(kind);
+}
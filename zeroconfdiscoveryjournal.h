@@ -0,0 +1,103 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef ZEROCONFDISCOVERYJOURNAL_H
+#define ZEROCONFDISCOVERYJOURNAL_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+
+#include <atomic>
+
+// Fixed size ring buffer of binary discovery events for post-mortem analysis.
+// Recording an event is lock-free and does not allocate. Interning ids and dumping
+// must happen on the thread running the event loop which drives the dns_sd callbacks.
+class ZeroConfDiscoveryJournal
+{
+public:
+    enum EventKind {
+        EventKindBrowseAdded = 1,
+        EventKindBrowseRemoved,
+        EventKindBrowseFailed,
+        EventKindResolveFailed,
+        EventKindResolved,
+        EventKindAddressFailed,
+        EventKindAddressResolved,
+        EventKindEntryAdded,
+        EventKindEntryDuplicate,
+        EventKindRegistered,
+        EventKindRegisterFailed,
+        EventKindUnregistered,
+        EventKindReannounced,
+        EventKindHostLookupFailed
+    };
+
+    class Record {
+    public:
+        qint64 timestamp = 0;
+        quint32 kind = 0;
+        quint32 id = 0;
+        quint32 interfaceIndex = 0;
+        qint32 errorCode = 0;
+        quint32 flags = 0;
+    };
+
+    static const quint32 capacity = 4096;
+
+    static ZeroConfDiscoveryJournal *instance();
+
+    quint32 intern(const QString &id);
+    void record(EventKind kind, quint32 id, quint32 interfaceIndex = 0, qint32 errorCode = 0, quint32 flags = 0);
+
+    quint64 recordCount() const;
+    bool dump(const QString &fileName) const;
+    static bool load(const QString &fileName, QStringList *ids, QList<Record> *records);
+
+    static QString eventKindToString(quint32 kind);
+
+private:
+    ZeroConfDiscoveryJournal();
+
+    class Slot {
+    public:
+        std::atomic<quint64> sequence{0};
+        Record record;
+    };
+
+    Slot m_slots[capacity];
+    std::atomic<quint64> m_head{0};
+
+    QHash<QString, quint32> m_idIndex;
+    QStringList m_ids;
+};
+
+#endif // ZEROCONFDISCOVERYJOURNAL_H
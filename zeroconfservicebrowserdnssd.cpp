@@ -29,6 +29,7 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "zeroconfservicebrowserdnssd.h"
+#include "zeroconfdiscoveryjournal.h"
 #include "loggingcategories.h"
 
 #include <QHostAddress>
@@ -45,7 +46,33 @@ ZeroConfServiceBrowserDnssd::ZeroConfServiceBrowserDnssd(const QString &serviceT
         return;
     }
 
-    DNSServiceErrorType err = DNSServiceBrowse(&m_browser, 0, 0, serviceType.toUtf8(), 0, (DNSServiceBrowseReply) ZeroConfServiceBrowserDnssd::browseCallback, this);
+    // A subtype can be given as "_type._tcp,_subtype" in which case the daemon only reports
+    // instances registered with that subtype. dns_sd only allows a single subtype when browsing.
+    QStringList typeParts;
+    foreach (const QString &part, serviceType.split(',')) {
+        typeParts.append(part.trimmed());
+    }
+    if (typeParts.contains(QString())) {
+        qCWarning(dcPlatformZeroConf) << "Invalid service type" << serviceType << "for service browser.";
+        return;
+    }
+    foreach (const QString &subType, typeParts.mid(1)) {
+        if (subType.toUtf8().length() > 63) {
+            qCWarning(dcPlatformZeroConf) << "Subtype" << subType << "of service browser exceeds 63 bytes.";
+            return;
+        }
+    }
+
+    QString baseType = typeParts.takeFirst();
+    QString browseType = baseType;
+    if (!typeParts.isEmpty()) {
+        if (typeParts.count() > 1) {
+            qCWarning(dcPlatformZeroConf) << "Only one subtype can be browsed at a time. Using" << typeParts.first() << "for" << serviceType;
+        }
+        browseType = QString("%1,%2").arg(baseType).arg(typeParts.first());
+    }
+
+    DNSServiceErrorType err = DNSServiceBrowse(&m_browser, 0, 0, browseType.toUtf8(), 0, (DNSServiceBrowseReply) ZeroConfServiceBrowserDnssd::browseCallback, this);
     if (err != kDNSServiceErr_NoError) {
         qCWarning(dcPlatformZeroConf) << "Failed to create service browser:" << err;
         return;
@@ -66,7 +93,7 @@ ZeroConfServiceBrowserDnssd::ZeroConfServiceBrowserDnssd(const QString &serviceT
         }
     });
 
-    qCDebug(dcPlatformZeroConf) << "Service browser created.";
+    qCDebug(dcPlatformZeroConf) << "Service browser created for" << browseType;
 }
 
 ZeroConfServiceBrowserDnssd::~ZeroConfServiceBrowserDnssd()
@@ -81,9 +108,23 @@ QList<ZeroConfServiceEntry> ZeroConfServiceBrowserDnssd::serviceEntries() const
 void DNSSD_API ZeroConfServiceBrowserDnssd::browseCallback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex, DNSServiceErrorType errorCode, const char *serviceName, const char *regtype, const char *replyDomain, void *context)
 {
     Q_UNUSED(sdRef)
-    Q_UNUSED(errorCode)
 
     ZeroConfServiceBrowserDnssd *self = static_cast<ZeroConfServiceBrowserDnssd*>(context);
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+
+    if (errorCode != kDNSServiceErr_NoError) {
+        qCWarning(dcPlatformZeroConf) << "Service browser reported error:" << errorCode;
+        journal->record(ZeroConfDiscoveryJournal::EventKindBrowseFailed, 0, interfaceIndex, errorCode, flags);
+        return;
+    }
+
+    // Subtype browses may report the subtype as part of the regtype. Entries and resolving use the base type.
+    QByteArray baseRegType(regtype);
+    int subTypeIndex = baseRegType.indexOf("._sub.");
+    if (subTypeIndex >= 0) {
+        baseRegType.remove(0, subTypeIndex + 6);
+    }
+    regtype = baseRegType.constData();
 
     if (flags & kDNSServiceFlagsAdd) {
 
@@ -95,10 +136,13 @@ void DNSSD_API ZeroConfServiceBrowserDnssd::browseCallback(DNSServiceRef sdRef,
         resolverContext->serviceType = QString::fromUtf8(regtype);
         resolverContext->serviceType.remove(QRegExp(".$"));
         resolverContext->domain = QString::fromUtf8(replyDomain);
+        resolverContext->journalId = journal->intern(resolverContext->name + "." + resolverContext->serviceType);
+        journal->record(ZeroConfDiscoveryJournal::EventKindBrowseAdded, resolverContext->journalId, interfaceIndex, 0, flags);
 
         DNSServiceErrorType err = DNSServiceResolve(&resolverContext->ref, 0, interfaceIndex, serviceName, regtype, replyDomain, (DNSServiceResolveReply) ZeroConfServiceBrowserDnssd::resolveCallback, resolverContext);
         if (err != kDNSServiceErr_NoError) {
             qCWarning(dcPlatformZeroConf) << "Failed to create service resolver:" << err;
+            journal->record(ZeroConfDiscoveryJournal::EventKindResolveFailed, resolverContext->journalId, interfaceIndex, err, flags);
             delete resolverContext;
             return;
         }
@@ -127,6 +171,7 @@ void DNSSD_API ZeroConfServiceBrowserDnssd::browseCallback(DNSServiceRef sdRef,
         QString id = QString("%1.%2@%3").arg(serviceName).arg(serviceType).arg(interfaceIndex);
 
         qCDebug(dcPlatformZeroConf) << "Service disappeared:" << id;
+        journal->record(ZeroConfDiscoveryJournal::EventKindBrowseRemoved, journal->intern(QString("%1.%2").arg(serviceName).arg(serviceType)), interfaceIndex, 0, flags);
 
         if (self->m_serviceEntries.contains(id)) {
             qCDebug(dcPlatformZeroConf()) << "Entry removed:" << id;
@@ -139,8 +184,6 @@ void DNSSD_API ZeroConfServiceBrowserDnssd::browseCallback(DNSServiceRef sdRef,
 void ZeroConfServiceBrowserDnssd::resolveCallback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex, DNSServiceErrorType errorCode, const char *fullname, const char *hosttarget, uint16_t port, uint16_t txtLen, const unsigned char *txtRecord, void *context)
 {
     Q_UNUSED(sdRef)
-    Q_UNUSED(flags)
-    Q_UNUSED(interfaceIndex)
     Q_UNUSED(fullname)
 //    qCDebug(dcPlatformZeroConf) << "Resolve callback" << flags << interfaceIndex << errorCode << fullname << hosttarget << port << txtLen << txtRecord << context;
 
@@ -149,16 +192,21 @@ void ZeroConfServiceBrowserDnssd::resolveCallback(DNSServiceRef sdRef, DNSServic
     DNSServiceRefDeallocate(resolverContext->ref);
     delete resolverContext->socketNotifier;
 
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+
     if (errorCode != kDNSServiceErr_NoError) {
         qCWarning(dcPlatformZeroConf) << "Failed to resolve service" << fullname << "Error code:" << errorCode;
+        journal->record(ZeroConfDiscoveryJournal::EventKindResolveFailed, resolverContext->journalId, interfaceIndex, errorCode, flags);
         delete resolverContext;
         return;
     }
+    journal->record(ZeroConfDiscoveryJournal::EventKindResolved, resolverContext->journalId, interfaceIndex, 0, flags);
 
     Context *addrContext = new Context();
     addrContext->self = self;
     addrContext->name = resolverContext->name;
     addrContext->serviceType = resolverContext->serviceType;
+    addrContext->journalId = resolverContext->journalId;
     addrContext->domain = resolverContext->domain;
     addrContext->hostName = QString::fromUtf8(hosttarget);
     addrContext->port = qFromBigEndian<quint16>(port);
@@ -203,12 +251,15 @@ void ZeroConfServiceBrowserDnssd::resolveCallback(DNSServiceRef sdRef, DNSServic
     errorCode = DNSServiceGetAddrInfo(&addrContext->ref, kDNSServiceFlagsForceMulticast, interfaceIndex, kDNSServiceProtocol_IPv4, hosttarget, (DNSServiceGetAddrInfoReply)addressCallback, addrContext);
     if (errorCode != kDNSServiceErr_NoError) {
         qCWarning(dcPlatformZeroConf) << "Failed to get address info";
+        journal->record(ZeroConfDiscoveryJournal::EventKindAddressFailed, addrContext->journalId, interfaceIndex, errorCode);
         delete addrContext;
+        return;
     }
     int sockfd = DNSServiceRefSockFD(addrContext->ref);
     if (sockfd == -1) {
         DNSServiceRefDeallocate(addrContext->ref);
         delete addrContext;
+        return;
     }
 
     addrContext->socketNotifier = new QSocketNotifier(sockfd, QSocketNotifier::Read, self);
@@ -233,10 +284,17 @@ void ZeroConfServiceBrowserDnssd::lookupFinished(const QHostInfo &info)
     }
     Context *addrContext = m_pendingLookups.take(info.lookupId());
 
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    quint32 journalId = addrContext->journalId;
+
     if (info.error() != QHostInfo::NoError) {
         qCWarning(dcPlatformZeroConf()) << "Error resolving host address for" << addrContext->serviceType << addrContext->hostName << info.errorString();
+        // QHostInfo errors are not dns_sd error codes, keep them apart in the journal
+        journal->record(ZeroConfDiscoveryJournal::EventKindHostLookupFailed, journalId, addrContext->interfaceIndex, info.error());
+        delete addrContext;
         return;
     }
+    journal->record(ZeroConfDiscoveryJournal::EventKindAddressResolved, journalId, addrContext->interfaceIndex);
     QString id = QString("%1.%2@%3").arg(addrContext->name).arg(addrContext->serviceType).arg(addrContext->interfaceIndex);
 
     qCDebug(dcPlatformZeroConf()) << "Host resolved" << id;
@@ -245,10 +303,12 @@ void ZeroConfServiceBrowserDnssd::lookupFinished(const QHostInfo &info)
 
         if (!m_serviceEntries.contains(id)) {
             qCDebug(dcPlatformZeroConf()) << "Entry added" << id << "(" + entry.hostAddress().toString() + ")";
+            journal->record(ZeroConfDiscoveryJournal::EventKindEntryAdded, journalId, addrContext->interfaceIndex);
             m_serviceEntries.insert(id, entry);
             emit serviceEntryAdded(entry);
         } else {
             qCDebug(dcPlatformZeroConf()) << "Discarding duplicate entry:" << id << "(" + entry.hostAddress().toString() + ")";
+            journal->record(ZeroConfDiscoveryJournal::EventKindEntryDuplicate, journalId, addrContext->interfaceIndex);
         }
     }
     delete addrContext;
@@ -260,7 +320,6 @@ void ZeroConfServiceBrowserDnssd::lookupFinished(const QHostInfo &info)
 void ZeroConfServiceBrowserDnssd::addressCallback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex, DNSServiceErrorType errorCode, const char *hostname, const sockaddr *address, uint32_t ttl, void *context)
 {
     Q_UNUSED(sdRef)
-    Q_UNUSED(flags)
     Q_UNUSED(hostname)
     Q_UNUSED(ttl)
 
@@ -269,11 +328,16 @@ void ZeroConfServiceBrowserDnssd::addressCallback(DNSServiceRef sdRef, DNSServic
     DNSServiceRefDeallocate(addressContext->ref);
     delete addressContext->socketNotifier;
 
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    quint32 journalId = addressContext->journalId;
+
     if (errorCode != kDNSServiceErr_NoError) {
         qCWarning(dcPlatformZeroConf) << "Failed to resolve address" << errorCode;
+        journal->record(ZeroConfDiscoveryJournal::EventKindAddressFailed, journalId, interfaceIndex, errorCode, flags);
         delete addressContext;
         return;
     }
+    journal->record(ZeroConfDiscoveryJournal::EventKindAddressResolved, journalId, interfaceIndex, 0, flags);
 
     QHostAddress addr(address);
 
@@ -284,10 +348,12 @@ void ZeroConfServiceBrowserDnssd::addressCallback(DNSServiceRef sdRef, DNSServic
 
     if (!self->m_serviceEntries.contains(id)) {
         qCDebug(dcPlatformZeroConf()) << "Entry added" << id << "(" + entry.hostAddress().toString() + ")";
+        journal->record(ZeroConfDiscoveryJournal::EventKindEntryAdded, journalId, interfaceIndex, 0, flags);
         self->m_serviceEntries.insert(id, entry);
         emit self->serviceEntryAdded(entry);
     } else {
         qCDebug(dcPlatformZeroConf()) << "Discarding duplicate entry:" << id << "(" + entry.hostAddress().toString() + ")";
+        journal->record(ZeroConfDiscoveryJournal::EventKindEntryDuplicate, journalId, interfaceIndex, 0, flags);
     }
 
     delete addressContext;
@@ -77,6 +77,7 @@ private:
         int port = 0;
         uint interfaceIndex = 0;
         QStringList txt;
+        quint32 journalId = 0;
         DNSServiceRef ref;
         QSocketNotifier *socketNotifier = nullptr;
         ZeroConfServiceBrowserDnssd *self = nullptr;
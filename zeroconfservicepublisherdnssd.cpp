@@ -29,13 +29,47 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "zeroconfservicepublisherdnssd.h"
+#include "zeroconfdiscoveryjournal.h"
 
 #include <loggingcategories.h>
 #include <QNetworkInterface>
 #include <QtEndian>
 
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
 ZeroConfServicePublisherDnssd::ZeroConfServicePublisherDnssd(QObject *parent) : ZeroConfServicePublisher(parent)
 {
+    // The ifIndex of a registration is fixed when it is registered. Watch the network interfaces
+    // and re-register affected services after DHCP renumbering, link flaps and the like.
+    // Every change restarts the settle timer, so a burst results in one round of announcements.
+    m_interfaceSnapshot = networkInterfaceSnapshot();
+    m_announcedSnapshot = m_interfaceSnapshot;
+
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(5000);
+    connect(&m_settleTimer, &QTimer::timeout, this, &ZeroConfServicePublisherDnssd::reannounceServices);
+
+    // Fallback only. The poll interval must stay below the settle interval so consecutive
+    // changes seen by polling keep restarting the settle timer.
+    m_networkPollTimer.setInterval(2000);
+    connect(&m_networkPollTimer, &QTimer::timeout, this, &ZeroConfServicePublisherDnssd::checkNetworkInterfaces);
+
+    if (!setupNetlinkMonitor()) {
+        qCWarning(dcPlatformZeroConf()) << "Unable to monitor network changes using netlink. Falling back to polling network interfaces.";
+    }
+}
+
+ZeroConfServicePublisherDnssd::~ZeroConfServicePublisherDnssd()
+{
+    if (m_netlinkSocket != -1) {
+        delete m_netlinkNotifier;
+        close(m_netlinkSocket);
+    }
 }
 
 bool ZeroConfServicePublisherDnssd::registerService(const QString &name, const QHostAddress &hostAddress, const quint16 &port, const QString &serviceType, const QHash<QString, QString> &txtRecords)
@@ -46,47 +80,62 @@ bool ZeroConfServicePublisherDnssd::registerService(const QString &name, const Q
     }
 
 
+    // Subtypes are appended to the type as "_type._tcp,_subtype1,_subtype2" and registered along with the service.
+    QStringList typeParts;
+    foreach (const QString &part, serviceType.split(',')) {
+        typeParts.append(part.trimmed());
+    }
+    if (typeParts.contains(QString())) {
+        qCWarning(dcPlatformZeroConf) << "Invalid service type" << serviceType << "for service" << name;
+        return false;
+    }
+    foreach (const QString &subType, typeParts.mid(1)) {
+        if (subType.toUtf8().length() > 63) {
+            qCWarning(dcPlatformZeroConf) << "Subtype" << subType << "of service" << name << "exceeds 63 bytes.";
+            return false;
+        }
+    }
+
     Context *ctx = new Context();
     ctx->self = this;
     ctx->name = name;
+    ctx->hostAddress = hostAddress;
+    ctx->port = port;
+    ctx->serviceType = typeParts.join(',');
+    ctx->txtRecords = txtRecords;
+    ctx->journalId = ZeroConfDiscoveryJournal::instance()->intern(name);
 
-    return registerServiceInternal(ctx, hostAddress, port, serviceType, txtRecords);
+    if (!registerServiceInternal(ctx)) {
+        return false;
+    }
+    startNetworkPolling();
+    return true;
 }
 
-bool ZeroConfServicePublisherDnssd::registerServiceInternal(ZeroConfServicePublisherDnssd::Context *ctx, const QHostAddress &hostAddress, const quint16 &port, const QString &serviceType, const QHash<QString, QString> &txtRecords)
+bool ZeroConfServicePublisherDnssd::registerServiceInternal(ZeroConfServicePublisherDnssd::Context *ctx)
 {
-
-    uint32_t ifIndex = 0;
-    if (hostAddress != QHostAddress("0.0.0.0")) {
-        foreach (const QNetworkInterface &interface, QNetworkInterface::allInterfaces()) {
-            foreach (const QNetworkAddressEntry &addressEntry, interface.addressEntries()) {
-                QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(addressEntry.ip().toString() + "/" + addressEntry.netmask().toString());
-                if (hostAddress.isInSubnet(subnet.first, subnet.second)) {
-                    ifIndex = static_cast<uint32_t>(interface.index());
-                    break;
-                }
-            }
-        }
-    }
+    ctx->ifIndex = interfaceIndex(ctx->hostAddress);
 
     QByteArray txt;
-    foreach (const QString &key, txtRecords.keys()) {
+    foreach (const QString &key, ctx->txtRecords.keys()) {
         QString record = key;
         record.append("=");
-        record.append(txtRecords.value(key));
+        record.append(ctx->txtRecords.value(key));
         txt.append(static_cast<quint8>(record.size()));
         txt.append(record.toUtf8());
     }
 
     ctx->effectiveName = ctx->name + ((ctx->collisionIndex > 0) ? " #" + QString::number(ctx->collisionIndex) : "");
 
-    DNSServiceErrorType err = DNSServiceRegister(&ctx->ref, 0, ifIndex, ctx->effectiveName.toUtf8().data(), serviceType.toUtf8().data(), 0, 0, qFromBigEndian<quint16>(port), txt.length(), txt, (DNSServiceRegisterReply) registerCallback, ctx);
+    DNSServiceErrorType err = DNSServiceRegister(&ctx->ref, 0, ctx->ifIndex, ctx->effectiveName.toUtf8().data(), ctx->serviceType.toUtf8().data(), 0, 0, qFromBigEndian<quint16>(ctx->port), txt.length(), txt, (DNSServiceRegisterReply) registerCallback, ctx);
     if (err != kDNSServiceErr_NoError) {
         qCWarning(dcPlatformZeroConf) << "Failed to register ZeroConf service" << ctx->name << "with dns_sd. Error:" << err;
+        ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+        journal->record(ZeroConfDiscoveryJournal::EventKindRegisterFailed, ctx->journalId, ctx->ifIndex, err);
         if (err == kDNSServiceErr_NameConflict) {
             qCDebug(dcPlatformZeroConf()) << "Handling service collision";
             ctx->collisionIndex++;
-            return registerServiceInternal(ctx, hostAddress, port, serviceType, txtRecords);
+            return registerServiceInternal(ctx);
         }
         delete ctx;
         return false;
@@ -113,11 +162,158 @@ bool ZeroConfServicePublisherDnssd::registerServiceInternal(ZeroConfServicePubli
     });
 
     m_services.insert(ctx->name, ctx);
-    qCDebug(dcPlatformZeroConf) << "ZeroConf service" << ctx->name << serviceType << port << "registerd at dns_sd as" << ctx->effectiveName;
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    journal->record(ZeroConfDiscoveryJournal::EventKindRegistered, ctx->journalId, ctx->ifIndex);
+    qCDebug(dcPlatformZeroConf) << "ZeroConf service" << ctx->name << ctx->serviceType << ctx->port << "registerd at dns_sd as" << ctx->effectiveName << "on interface" << ctx->ifIndex;
     return true;
 
 }
 
+void ZeroConfServicePublisherDnssd::releaseService(ZeroConfServicePublisherDnssd::Context *ctx)
+{
+    ctx->socketNotifier->setEnabled(false);
+    ctx->socketNotifier->deleteLater();
+    ctx->socketNotifier = nullptr;
+    DNSServiceRefDeallocate(ctx->ref);
+}
+
+bool ZeroConfServicePublisherDnssd::setupNetlinkMonitor()
+{
+    m_netlinkSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (m_netlinkSocket == -1) {
+        return false;
+    }
+
+    sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(m_netlinkSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+        close(m_netlinkSocket);
+        m_netlinkSocket = -1;
+        return false;
+    }
+
+    m_netlinkNotifier = new QSocketNotifier(m_netlinkSocket, QSocketNotifier::Read, this);
+    connect(m_netlinkNotifier, &QSocketNotifier::activated, this, [this]{
+        // The content doesn't matter, the settle timeout compares the interfaces anyways.
+        char buffer[8192];
+        forever {
+            ssize_t length = recv(m_netlinkSocket, buffer, sizeof(buffer), 0);
+            if (length < 0 && errno == ENOBUFS) {
+                continue;
+            }
+            if (length <= 0) {
+                break;
+            }
+        }
+        m_settleTimer.start();
+    });
+    return true;
+}
+
+void ZeroConfServicePublisherDnssd::startNetworkPolling()
+{
+    if (m_netlinkNotifier || m_networkPollTimer.isActive()) {
+        return;
+    }
+
+    // Polling is stopped while no services are registered, start over from the current state.
+    m_interfaceSnapshot = networkInterfaceSnapshot();
+    m_announcedSnapshot = m_interfaceSnapshot;
+    m_networkPollTimer.start();
+}
+
+uint32_t ZeroConfServicePublisherDnssd::interfaceIndex(const QHostAddress &hostAddress)
+{
+    uint32_t ifIndex = 0;
+    if (hostAddress == QHostAddress("0.0.0.0")) {
+        return ifIndex;
+    }
+
+    // If the address matches multiple interfaces, the last one wins
+    foreach (const QNetworkInterface &interface, QNetworkInterface::allInterfaces()) {
+        foreach (const QNetworkAddressEntry &addressEntry, interface.addressEntries()) {
+            QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(addressEntry.ip().toString() + "/" + addressEntry.netmask().toString());
+            if (hostAddress.isInSubnet(subnet.first, subnet.second)) {
+                ifIndex = static_cast<uint32_t>(interface.index());
+                break;
+            }
+        }
+    }
+    return ifIndex;
+}
+
+QHash<int, QStringList> ZeroConfServicePublisherDnssd::networkInterfaceSnapshot()
+{
+    QHash<int, QStringList> snapshot;
+    foreach (const QNetworkInterface &interface, QNetworkInterface::allInterfaces()) {
+        QStringList state;
+        state.append(QString::number(static_cast<int>(interface.flags() & (QNetworkInterface::IsUp | QNetworkInterface::IsRunning))));
+        foreach (const QNetworkAddressEntry &addressEntry, interface.addressEntries()) {
+            state.append(addressEntry.ip().toString() + "/" + QString::number(addressEntry.prefixLength()));
+        }
+        snapshot.insert(interface.index(), state);
+    }
+    return snapshot;
+}
+
+void ZeroConfServicePublisherDnssd::checkNetworkInterfaces()
+{
+    if (m_services.isEmpty()) {
+        m_networkPollTimer.stop();
+        return;
+    }
+
+    QHash<int, QStringList> snapshot = networkInterfaceSnapshot();
+    if (snapshot == m_interfaceSnapshot) {
+        return;
+    }
+
+    qCDebug(dcPlatformZeroConf()) << "Network interfaces changed. Waiting for the network to settle before re-announcing services.";
+    m_interfaceSnapshot = snapshot;
+    m_settleTimer.start();
+}
+
+void ZeroConfServicePublisherDnssd::reannounceServices()
+{
+    QHash<int, QStringList> snapshot = networkInterfaceSnapshot();
+
+    // Only registrations bound to an interface which changed, or which would bind to a
+    // different interface now, need to be re-registered. Wildcard ones are handled by the daemon.
+    QList<Context*> affected;
+    foreach (Context *ctx, m_services) {
+        uint32_t ifIndex = interfaceIndex(ctx->hostAddress);
+        if (ifIndex != ctx->ifIndex) {
+            affected.append(ctx);
+        } else if (ctx->ifIndex != 0 && snapshot.value(static_cast<int>(ctx->ifIndex)) != m_announcedSnapshot.value(static_cast<int>(ctx->ifIndex))) {
+            affected.append(ctx);
+        }
+    }
+    m_announcedSnapshot = snapshot;
+    m_interfaceSnapshot = snapshot;
+
+    if (affected.isEmpty()) {
+        return;
+    }
+
+    qCDebug(dcPlatformZeroConf()) << "Re-announcing" << affected.count() << "ZeroConf services after network change";
+
+    // Withdraw all affected registrations first, then announce them again in one batch
+    foreach (Context *ctx, affected) {
+        m_services.remove(ctx->name);
+        releaseService(ctx);
+    }
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    foreach (Context *ctx, affected) {
+        QString name = ctx->name;
+        journal->record(ZeroConfDiscoveryJournal::EventKindReannounced, ctx->journalId, ctx->ifIndex);
+        if (!registerServiceInternal(ctx)) {
+            qCWarning(dcPlatformZeroConf()) << "Failed to re-announce ZeroConf service" << name;
+        }
+    }
+}
+
 void ZeroConfServicePublisherDnssd::unregisterService(const QString &name)
 {
     if (!m_services.contains(name)) {
@@ -127,8 +323,9 @@ void ZeroConfServicePublisherDnssd::unregisterService(const QString &name)
 
     qCDebug(dcPlatformZeroConf) << "ZeroConf service" << name << "unregistered";
     Context *ctx = m_services.take(name);
-    ctx->socketNotifier->deleteLater();
-    DNSServiceRefDeallocate(ctx->ref);
+    ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+    journal->record(ZeroConfDiscoveryJournal::EventKindUnregistered, ctx->journalId, ctx->ifIndex);
+    releaseService(ctx);
     delete ctx;
 }
 
@@ -137,6 +334,8 @@ void DNSSD_API ZeroConfServicePublisherDnssd::registerCallback(DNSServiceRef, DN
     if (errorCode != kDNSServiceErr_NoError) {
         Context *ctx = static_cast<Context*>(userdata);
         qCWarning(dcPlatformZeroConf) << "Zeroconf registration failed with error code" << errorCode << ctx->name;
+        ZeroConfDiscoveryJournal *journal = ZeroConfDiscoveryJournal::instance();
+        journal->record(ZeroConfDiscoveryJournal::EventKindRegisterFailed, ctx->journalId, ctx->ifIndex, errorCode);
         DNSServiceRefDeallocate(ctx->ref);
         ctx->self->m_services.remove(ctx->name);
         ctx->socketNotifier->deleteLater();
@@ -33,7 +33,10 @@
 
 #include <QObject>
 #include <QHash>
+#include <QStringList>
 #include <QSocketNotifier>
+#include <QHostAddress>
+#include <QTimer>
 
 #include <network/zeroconf/zeroconfservicepublisher.h>
 
@@ -45,29 +48,54 @@ class ZeroConfServicePublisherDnssd: public ZeroConfServicePublisher
     Q_OBJECT
 public:
     explicit ZeroConfServicePublisherDnssd(QObject *parent = nullptr);
+    ~ZeroConfServicePublisherDnssd() override;
 
     bool registerService(const QString &name, const QHostAddress &hostAddress, const quint16 &port, const QString &serviceType, const QHash<QString, QString> &txtRecords) override;
     void unregisterService(const QString &name) override;
 
     static void DNSSD_API registerCallback(DNSServiceRef, DNSServiceFlags, DNSServiceErrorType errorCode, const char *, const char *, const char *, void *userdata);
 
+private slots:
+    void checkNetworkInterfaces();
+    void reannounceServices();
+
 private:
     class Context {
     public:
         QString name;
         QString effectiveName;
+        QHostAddress hostAddress;
+        quint16 port = 0;
+        QString serviceType;
+        QHash<QString, QString> txtRecords;
+        uint32_t ifIndex = 0;
         int collisionIndex = 0;
+        quint32 journalId = 0;
         DNSServiceRef ref;
         ZeroConfServicePublisherDnssd *self;
         QSocketNotifier *socketNotifier = nullptr;
     };
 
-    bool registerServiceInternal(Context *ctx, const QHostAddress &hostAddress, const quint16 &port, const QString &serviceType, const QHash<QString, QString> &txtRecords);
+    bool registerServiceInternal(Context *ctx);
+    void releaseService(Context *ctx);
 
+    bool setupNetlinkMonitor();
+    void startNetworkPolling();
 
+    static uint32_t interfaceIndex(const QHostAddress &hostAddress);
+    static QHash<int, QStringList> networkInterfaceSnapshot();
 
     QHash<QString, Context*> m_services;
 
+    // Network changes are reported by netlink, or polled if that's not available, and
+    // services are re-announced in one go once the network settled down
+    int m_netlinkSocket = -1;
+    QSocketNotifier *m_netlinkNotifier = nullptr;
+    QTimer m_networkPollTimer;
+    QTimer m_settleTimer;
+    QHash<int, QStringList> m_interfaceSnapshot;
+    QHash<int, QStringList> m_announcedSnapshot;
+
 };
 
 #endif // ZEROCONFSERVICEPUBLISHENSDK_H